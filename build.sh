@@ -40,7 +40,7 @@ print_help() {
     echo "Usage: ./build.sh [COMMAND] [OPTIONS]"
     echo ""
     echo "Commands:"
-    echo "  build [architecture]  Builds the specified 'pit' or 'pit_gif' executable."
+    echo "  build [architecture]  Builds the 'pit' executable."
     echo "                        <architecture> can be 'x86_64', 'aarch64', 'armv7l', 'riscv64', 'ppc64le', 'mips', 'i386'."
     echo "                        If no architecture is specified, it detects the host architecture."
     echo "  clean                 Removes the build directory and executables."
@@ -146,7 +146,7 @@ clean() {
             log_warning "Failed to remove log file: ${LOG_FILE}"
         fi
     fi
-    # Check for both pit and pit_gif executables in the current directory if they were moved there
+    # Check for pit and the old pit_gif executables in the current directory if they were moved there
     if [ -f "pit" ]; then
         rm "pit"
         log_info "Removed old 'pit' executable from root."
@@ -177,26 +177,9 @@ build() {
         exit 1
     fi
 
-    # --- Build Target Choice ---
-    BUILD_TARGET_CHOICE=""
-    while [[ "$BUILD_TARGET_CHOICE" != "p" && "$BUILD_TARGET_CHOICE" != "g" ]]; do
-        read -p "$(echo -e "${BLUE}Which executable to build? (p=pit, g=pit_gif, default: p): ${NC}")" BUILD_TARGET_INPUT
-        BUILD_TARGET_CHOICE=${BUILD_TARGET_INPUT:-p} # Default to pit
-        BUILD_TARGET_CHOICE=$(echo "$BUILD_TARGET_CHOICE" | tr '[:upper:]' '[:lower:]')
-        if [[ "$BUILD_TARGET_CHOICE" != "p" && "$BUILD_TARGET_CHOICE" != "g" ]]; then
-            log_warning "Invalid choice. Please enter 'p' or 'g'."
-        fi
-    done
-
-    if [ "$BUILD_TARGET_CHOICE" == "p" ]; then
-        SRC_FILE="./pit.c"
-        BIN_NAME="pit"
-        log_info "Building 'pit' (static image viewer)."
-    else # BUILD_TARGET_CHOICE == "g"
-        SRC_FILE="./pit_gif.c"
-        BIN_NAME="pit_gif"
-        log_info "Building 'pit_gif' (GIF 'animation' viewer)."
-    fi
+    SRC_FILE="./pit.c"
+    BIN_NAME="pit"
+    log_info "Building 'pit' (image viewer with GIF animation playback)."
 
 
     # Determine target architecture
@@ -210,8 +193,8 @@ build() {
         log_info "Building for specified architecture: ${TARGET_ARCH}"
     fi
 
-    local CFLAGS="-Wall -Wextra -pedantic -std=c11 -funroll-loops" # Added -funroll-loops
-    local LDFLAGS="-lm" 
+    local CFLAGS="-Wall -Wextra -pedantic -std=c11 -funroll-loops -pthread" # -pthread for the resize worker pool
+    local LDFLAGS="-lm -pthread" 
     local TARGET_SPEC=""
     local STATIC_BUILD_FLAG="no"
     local SANITIZER_FLAGS=""
@@ -393,6 +376,12 @@ build() {
         CFLAGS+=" -mfloat-abi=hard"
     fi
 
+    # Kitty shared memory transfers call shm_open, which glibc before 2.34 keeps in librt.
+    # Link it wherever the toolchain has one (newer glibc ships an empty librt).
+    if echo 'int main(void) { return 0; }' | "${COMPILER}" -x c - -o /dev/null -lrt > /dev/null 2>&1; then
+        LDFLAGS+=" -lrt"
+    fi
+
     log_info "Final compiler flags: ${CFLAGS}"
     log_info "Final linker flags: ${LDFLAGS}"
 
@@ -431,8 +431,27 @@ STBIDEF stbi_uc *stbi_load_from_file  (FILE *f, int *x, int *y, int *channels_in
 
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp);
+
+// frame-by-frame gif decoding: instead of returning every frame in one allocation,
+// hands each composited RGBA frame to frame_cb (with its delay in milliseconds) as soon
+// as it is decoded, reusing the buffer for the next one, so memory does not grow
+// with the frame count. frame_cb returns 0 to stop.
+// vertical flipping is not applied.
+// returns the number of frames passed to frame_cb; a corrupt frame ends the sequence
+// early, and 0 means not even the first frame decoded (see stbi_failure_reason)
+typedef int stbi_gif_frame_callback(void *user, int index, const stbi_uc *rgba, int w, int h, int delay_ms);
+STBIDEF int stbi_load_gif_frames_from_memory(stbi_uc const *buffer, int len, stbi_gif_frame_callback *frame_cb, void *user);
 #endif
 
+// row-by-row decoding: instead of returning the image, hands each output row to
+// row_cb (along with the image size and channels per pixel) as soon as it is ready,
+// reusing the row buffer for the next one. baseline JPEGs are color-converted while
+// they decode and only keep a few MCU rows of their planes; other formats, including
+// progressive JPEGs, are decoded in full first. vertical flipping is not applied.
+// returns 1 on success, 0 on failure (see stbi_failure_reason)
+typedef void stbi_row_callback(void *user, int y, const stbi_uc *row, int w, int h, int channels);
+STBIDEF int stbi_load_rows_from_memory(stbi_uc const *buffer, int len, int desired_channels, stbi_row_callback *row_cb, void *user);
+
 #ifdef STBI_WINDOWS_UTF8
 STBIDEF int stbi_convert_wchar_to_utf8(char *buffer, size_t bufferlen, const wchar_t* input);
 #endif
@@ -524,6 +543,12 @@ STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpre
 STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+// decode JPEGs at 1/2, 1/4 or 1/8 of their size (scale_log2 = 1, 2, 3; 0 = full size)
+// using a reduced-size IDCT, which is much cheaper than decoding and then shrinking.
+// output dimensions are rounded up. other formats are unaffected.
+STBIDEF void stbi_set_jpeg_scale_on_load(int scale_log2);
+STBIDEF void stbi_set_jpeg_scale_on_load_thread(int scale_log2);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -907,6 +932,7 @@ typedef struct
 
 #ifndef STBI_NO_JPEG
 static int      stbi__jpeg_test(stbi__context *s);
+static stbi_uc *stbi__jpeg_load_rows(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi_row_callback *row_cb, void *row_user);
 static void    *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri);
 static int      stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp);
 #endif
@@ -1134,6 +1160,29 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
+static int stbi__jpeg_scale_on_load_global = 0;
+
+STBIDEF void stbi_set_jpeg_scale_on_load(int scale_log2)
+{
+   stbi__jpeg_scale_on_load_global = scale_log2 < 0 ? 0 : scale_log2 > 3 ? 3 : scale_log2;
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__jpeg_scale_on_load  stbi__jpeg_scale_on_load_global
+#else
+static STBI_THREAD_LOCAL int stbi__jpeg_scale_on_load_local, stbi__jpeg_scale_on_load_set;
+
+STBIDEF void stbi_set_jpeg_scale_on_load_thread(int scale_log2)
+{
+   stbi__jpeg_scale_on_load_local = scale_log2 < 0 ? 0 : scale_log2 > 3 ? 3 : scale_log2;
+   stbi__jpeg_scale_on_load_set = 1;
+}
+
+#define stbi__jpeg_scale_on_load  (stbi__jpeg_scale_on_load_set       \
+                                   ? stbi__jpeg_scale_on_load_local  \
+                                   : stbi__jpeg_scale_on_load_global)
+#endif // STBI_THREAD_LOCAL
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1433,6 +1482,30 @@ STBIDEF stbi_uc *stbi_load_from_memory(stbi_uc const *buffer, int len, int *x, i
    return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
 }
 
+STBIDEF int stbi_load_rows_from_memory(stbi_uc const *buffer, int len, int req_comp, stbi_row_callback *row_cb, void *user)
+{
+   stbi__context s;
+   stbi_uc *data;
+   int x, y, comp, n, j;
+   stbi__start_mem(&s,buffer,len);
+   #ifndef STBI_NO_JPEG
+   if (stbi__jpeg_test(&s)) {
+      // the rows have all been handed out by now; what comes back is the row buffer
+      data = stbi__jpeg_load_rows(&s, &x, &y, &comp, req_comp, row_cb, user);
+      if (!data) return 0;
+      STBI_FREE(data);
+      return 1;
+   }
+   #endif
+   data = stbi_load_from_memory(buffer, len, &x, &y, &comp, req_comp);
+   if (!data) return 0;
+   n = req_comp ? req_comp : comp;
+   for (j=0; j < y; ++j)
+      row_cb(user, j, data + (size_t) j * x * n, x, y, n);
+   STBI_FREE(data);
+   return 1;
+}
+
 STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
 {
    stbi__context s;
@@ -1994,12 +2067,32 @@ typedef struct
    int scan_n, order[4];
    int restart_interval, todo;
 
+   int scale_log2;  // scaled decoding: each 8x8 block becomes block_size x block_size pixels
+   int block_size;  // 8 >> scale_log2
+
+   // row-by-row output (stbi_load_rows_from_memory)
+   stbi_row_callback *row_cb;
+   void *row_user;
+   int req_comp;
+   int plane_ring;  // >0: component planes only keep this many MCU rows
+   struct stbi__jpeg_rows *rows;
+
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
    void (*YCbCr_to_RGB_kernel)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
    stbi_uc *(*resample_row_hv_2_kernel)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
 } stbi__jpeg;
 
+// plane row y of component k; when decoding row by row the planes are a ring of MCU rows
+static stbi_uc *stbi__jpeg_plane_row(stbi__jpeg *z, int k, int y)
+{
+   if (z->plane_ring)
+      y %= z->plane_ring * z->img_comp[k].v * z->block_size;
+   return z->img_comp[k].data + z->img_comp[k].w2 * y;
+}
+
+static int stbi__jpeg_rows_ready(stbi__jpeg *z, int mcu_rows);
+
 static int stbi__build_huffman(stbi__huffman *h, int *count)
 {
    int i,j,k=0;
@@ -2523,6 +2616,61 @@ static void stbi__idct_block(stbi_uc *out, int out_stride, short data[64])
    }
 }
 
+// reduced-size IDCTs for scaled decoding: an NxN inverse DCT of the lowest NxN
+// coefficients, which approximates the 8x8 block box-filtered down to NxN.
+// with the JPEG normalization each 1D pass uses the basis C(u)/2 * cos((2x+1)u*pi/2N).
+#define STBI__IDCT_1D_4(s0,s1,s2,s3) \
+   int e0,e1,o0,o1;                             \
+   e0 = (s0+s2) * stbi__f2f(0.353553391f);      \
+   e1 = (s0-s2) * stbi__f2f(0.353553391f);      \
+   o0 = s1*stbi__f2f(0.461939766f) + s3*stbi__f2f(0.191341716f); \
+   o1 = s1*stbi__f2f(0.191341716f) - s3*stbi__f2f(0.461939766f);
+
+static void stbi__idct_block_4x4(stbi_uc *out, int out_stride, short data[64])
+{
+   int i,val[16],*v=val;
+   short *d = data;
+
+   // columns; constants scale by 1<<12, keep 2 extra bits of precision
+   for (i=0; i < 4; ++i,++d,++v) {
+      STBI__IDCT_1D_4(d[0],d[8],d[16],d[24])
+      e0 += 512; e1 += 512;
+      v[ 0] = (e0+o0) >> 10;
+      v[12] = (e0-o0) >> 10;
+      v[ 4] = (e1+o1) >> 10;
+      v[ 8] = (e1-o1) >> 10;
+   }
+   // rows; remove 1<<14 with rounding and level shift by 128
+   for (i=0, v=val; i < 4; ++i,v+=4,out+=out_stride) {
+      STBI__IDCT_1D_4(v[0],v[1],v[2],v[3])
+      e0 += (1 << 13) + (128 << 14);
+      e1 += (1 << 13) + (128 << 14);
+      out[0] = stbi__clamp((e0+o0) >> 14);
+      out[3] = stbi__clamp((e0-o0) >> 14);
+      out[1] = stbi__clamp((e1+o1) >> 14);
+      out[2] = stbi__clamp((e1-o1) >> 14);
+   }
+}
+
+static void stbi__idct_block_2x2(stbi_uc *out, int out_stride, short data[64])
+{
+   // both passes of the 2-point IDCT are (s0 +- s1) * 0.353553391, so combine them:
+   // 0.353553391^2 = 1/8
+   int a = data[0] + data[8], b = data[0] - data[8];
+   int c = data[1] + data[9], e = data[1] - data[9];
+   out[0]            = stbi__clamp(((a + c + 4) >> 3) + 128);
+   out[1]            = stbi__clamp(((a - c + 4) >> 3) + 128);
+   out[out_stride]   = stbi__clamp(((b + e + 4) >> 3) + 128);
+   out[out_stride+1] = stbi__clamp(((b - e + 4) >> 3) + 128);
+}
+
+static void stbi__idct_block_1x1(stbi_uc *out, int out_stride, short data[64])
+{
+   STBI_NOTUSED(out_stride);
+   // DC only: the block average is DC/8
+   out[0] = stbi__clamp(((data[0] + 4) >> 3) + 128);
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2950,6 +3098,11 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 {
    stbi__jpeg_reset(z);
    if (!z->progressive) {
+      // rows can only be handed out while a scan carries every component; when the
+      // components come in separate scans, the planes of the later ones are not decoded
+      // yet, so emission waits for the final conversion, which needs the whole planes
+      int rows_early = z->row_cb && z->scan_n == z->s->img_n;
+      if (z->row_cb && !rows_early && z->plane_ring) return stbi__err("multiscan", "Non-interleaved scans can't be decoded row by row");
       if (z->scan_n == 1) {
          int i,j;
          STBI_SIMD_ALIGN(short, data[64]);
@@ -2961,10 +3114,11 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          int w = (z->img_comp[n].x+7) >> 3;
          int h = (z->img_comp[n].y+7) >> 3;
          for (j=0; j < h; ++j) {
+            if (rows_early && j && j % z->img_comp[n].v == 0 && !stbi__jpeg_rows_ready(z, j / z->img_comp[n].v)) return 0;
             for (i=0; i < w; ++i) {
                int ha = z->img_comp[n].ha;
                if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               z->idct_block_kernel(stbi__jpeg_plane_row(z, n, j*z->block_size)+i*z->block_size, z->img_comp[n].w2, data);
                // every data block is an MCU, so countdown the restart interval
                if (--z->todo <= 0) {
                   if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
@@ -2980,6 +3134,8 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          int i,j,k,x,y;
          STBI_SIMD_ALIGN(short, data[64]);
          for (j=0; j < z->img_mcu_y; ++j) {
+            // hand out the rows the MCU rows decoded so far are enough for
+            if (rows_early && j && !stbi__jpeg_rows_ready(z, j)) return 0;
             for (i=0; i < z->img_mcu_x; ++i) {
                // scan an interleaved mcu... process scan_n components in order
                for (k=0; k < z->scan_n; ++k) {
@@ -2988,11 +3144,11 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
                   // by the basic H and V specified for the component
                   for (y=0; y < z->img_comp[n].v; ++y) {
                      for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
+                        int x2 = (i*z->img_comp[n].h + x)*z->block_size;
+                        int y2 = (j*z->img_comp[n].v + y)*z->block_size;
                         int ha = z->img_comp[n].ha;
                         if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
+                        z->idct_block_kernel(stbi__jpeg_plane_row(z, n, y2)+x2, z->img_comp[n].w2, data);
                      }
                   }
                }
@@ -3089,7 +3245,7 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
             for (i=0; i < w; ++i) {
                short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
                stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
+               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*z->block_size+i*z->block_size, z->img_comp[n].w2, data);
             }
          }
       }
@@ -3318,6 +3474,12 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
    z->img_mcu_x = (s->img_x + z->img_mcu_w-1) / z->img_mcu_w;
    z->img_mcu_y = (s->img_y + z->img_mcu_h-1) / z->img_mcu_h;
 
+   // baseline data decoded row by row only needs the MCU rows the upsampler is still
+   // looking at; keep a few more when scaled, as each MCU row is then only a few pixels
+   z->plane_ring = 0;
+   if (z->row_cb && !z->progressive && z->img_mcu_y > (4 << z->scale_log2))
+      z->plane_ring = 4 << z->scale_log2;
+
    for (i=0; i < s->img_n; ++i) {
       // number of effective pixels (e.g. for non-interleaved MCU)
       z->img_comp[i].x = (s->img_x * z->img_comp[i].h + h_max-1) / h_max;
@@ -3329,8 +3491,9 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       //
       // img_mcu_x, img_mcu_y: <=17 bits; comp[i].h and .v are <=4 (checked earlier)
       // so these muls can't overflow with 32-bit ints (which we require)
-      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
-      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+      // with scaled decoding the planes hold block_size pixels per 8x8 block
+      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * z->block_size;
+      z->img_comp[i].h2 = (z->plane_ring ? z->plane_ring : z->img_mcu_y) * z->img_comp[i].v * z->block_size;
       z->img_comp[i].coeff = 0;
       z->img_comp[i].raw_coeff = 0;
       z->img_comp[i].linebuf = NULL;
@@ -3340,10 +3503,10 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       // align blocks for idct using mmx/sse
       z->img_comp[i].data = (stbi_uc*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
       if (z->progressive) {
-         // w2, h2 are multiples of 8 (see above)
-         z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
-         z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
-         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].w2, z->img_comp[i].h2, sizeof(short), 15);
+         // coefficients are kept for every block at full size, whatever the scale
+         z->img_comp[i].coeff_w = z->img_mcu_x * z->img_comp[i].h;
+         z->img_comp[i].coeff_h = z->img_mcu_y * z->img_comp[i].v;
+         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].coeff_w * 8, z->img_comp[i].coeff_h * 8, sizeof(short), 15);
          if (z->img_comp[i].raw_coeff == NULL)
             return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
          z->img_comp[i].coeff = (short*) (((size_t) z->img_comp[i].raw_coeff + 15) & ~15);
@@ -3820,6 +3983,8 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
+   j->scale_log2 = 0;
+   j->block_size = 8;
    j->idct_block_kernel = stbi__idct_block;
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
@@ -3839,12 +4004,6 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
 #endif
 }
 
-// clean up the temporary component buffers
-static void stbi__cleanup_jpeg(stbi__jpeg *j)
-{
-   stbi__free_jpeg_components(j, j->s->img_n, 0);
-}
-
 typedef struct
 {
    resample_row_func resample;
@@ -3862,19 +4021,36 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
-static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+// resample and color-convert state, kept in the decoder so rows can be converted
+// while the entropy-coded data is still being decoded
+typedef struct stbi__jpeg_rows
 {
+   stbi__resample res_comp[4];
+   stbi_uc *output;              // whole image, or one reused row when handing out rows
    int n, decode_n, is_rgb;
-   z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+   stbi__uint32 out_x, out_y;    // output size, reduced when decoding scaled
+   stbi__uint32 comp_y[4];       // plane heights at output size
+   stbi__uint32 next_row;        // rows converted so far
+} stbi__jpeg_rows;
 
-   // validate req_comp
-   if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+// clean up the temporary component buffers and conversion state
+static void stbi__cleanup_jpeg(stbi__jpeg *j)
+{
+   stbi__free_jpeg_components(j, j->s->img_n, 0);
+   if (j->rows) {
+      STBI_FREE(j->rows->output);
+      STBI_FREE(j->rows);
+      j->rows = NULL;
+   }
+}
 
-   // load a jpeg image from whichever source, but leave in YCbCr format
-   if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
+static int stbi__jpeg_rows_begin(stbi__jpeg *z)
+{
+   stbi__jpeg_rows *rows;
+   int k, n, decode_n, is_rgb, round = (1 << z->scale_log2) - 1;
 
    // determine actual number of components to generate
-   n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
+   n = z->req_comp ? z->req_comp : z->s->img_n >= 3 ? 3 : 1;
 
    is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
 
@@ -3885,160 +4061,229 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
 
    // nothing to do if no components requested; check this now to avoid
    // accessing uninitialized coutput[0] later
-   if (decode_n <= 0) { stbi__cleanup_jpeg(z); return NULL; }
-
-   // resample and color-convert
-   {
-      int k;
-      unsigned int i,j;
-      stbi_uc *output;
-      stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+   if (decode_n <= 0) return 0;
+
+   rows = (stbi__jpeg_rows *) stbi__malloc(sizeof(stbi__jpeg_rows));
+   if (!rows) return stbi__err("outofmem", "Out of memory");
+   memset(rows, 0, sizeof(stbi__jpeg_rows));
+   z->rows = rows;
+   rows->n = n;
+   rows->decode_n = decode_n;
+   rows->is_rgb = is_rgb;
+
+   // scaled decoding: everything from here on works on the reduced planes
+   rows->out_x = (z->s->img_x + round) >> z->scale_log2;
+   rows->out_y = (z->s->img_y + round) >> z->scale_log2;
+
+   for (k=0; k < decode_n; ++k) {
+      stbi__resample *r = &rows->res_comp[k];
+
+      rows->comp_y[k] = (z->img_comp[k].y + round) >> z->scale_log2;
+
+      // allocate line buffer big enough for upsampling off the edges
+      // with upsample factor of 4
+      z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(rows->out_x + 3);
+      if (!z->img_comp[k].linebuf) return stbi__err("outofmem", "Out of memory");
+
+      r->hs      = z->img_h_max / z->img_comp[k].h;
+      r->vs      = z->img_v_max / z->img_comp[k].v;
+      r->ystep   = r->vs >> 1;
+      r->w_lores = (rows->out_x + r->hs-1) / r->hs;
+      r->ypos    = 0;
+      r->line0   = r->line1 = z->img_comp[k].data;
+
+      if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+      else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
+      else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
+      else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+      else                               r->resample = stbi__resample_row_generic;
+   }
+
+   // a single row is enough when every row is handed to the callback
+   rows->output = (stbi_uc *) stbi__malloc_mad3(n, rows->out_x, z->row_cb ? 1 : rows->out_y, 1);
+   if (!rows->output) return stbi__err("outofmem", "Out of memory");
+   return 1;
+}
 
-      stbi__resample res_comp[4];
+// resample and color-convert output rows up to (not including) upto
+static void stbi__jpeg_rows_convert(stbi__jpeg *z, stbi__uint32 upto)
+{
+   stbi__jpeg_rows *rows = z->rows;
+   int k, n = rows->n, decode_n = rows->decode_n, is_rgb = rows->is_rgb;
+   unsigned int i,j;
+   stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
 
+   for (j=rows->next_row; j < upto; ++j) {
+      stbi_uc *out = z->row_cb ? rows->output : rows->output + n * rows->out_x * j;
       for (k=0; k < decode_n; ++k) {
-         stbi__resample *r = &res_comp[k];
-
-         // allocate line buffer big enough for upsampling off the edges
-         // with upsample factor of 4
-         z->img_comp[k].linebuf = (stbi_uc *) stbi__malloc(z->s->img_x + 3);
-         if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-         r->hs      = z->img_h_max / z->img_comp[k].h;
-         r->vs      = z->img_v_max / z->img_comp[k].v;
-         r->ystep   = r->vs >> 1;
-         r->w_lores = (z->s->img_x + r->hs-1) / r->hs;
-         r->ypos    = 0;
-         r->line0   = r->line1 = z->img_comp[k].data;
-
-         if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
-         else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
-         else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
-         else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
-         else                               r->resample = stbi__resample_row_generic;
-      }
-
-      // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-      if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-      // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
+         stbi__resample *r = &rows->res_comp[k];
+         int y_bot = r->ystep >= (r->vs >> 1);
+         coutput[k] = r->resample(z->img_comp[k].linebuf,
+                                  y_bot ? r->line1 : r->line0,
+                                  y_bot ? r->line0 : r->line1,
+                                  r->w_lores, r->hs);
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < (int) rows->comp_y[k])
+               r->line1 = stbi__jpeg_plane_row(z, k, r->ypos);
          }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else if (z->s->img_n == 4) {
-               if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                     out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                     out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(255 - out[0], m);
-                     out[1] = stbi__blinn_8x8(255 - out[1], m);
-                     out[2] = stbi__blinn_8x8(255 - out[2], m);
-                     out += n;
-                  }
-               } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
+      }
+      if (n >= 3) {
+         stbi_uc *y = coutput[0];
+         if (z->s->img_n == 3) {
+            if (is_rgb) {
+               for (i=0; i < rows->out_x; ++i) {
+                  out[0] = y[i];
+                  out[1] = coutput[1][i];
+                  out[2] = coutput[2][i];
+                  out[3] = 255;
                   out += n;
                }
-         } else {
-            if (is_rgb) {
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
-                     *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-               else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
-                     out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                     out[1] = 255;
-                  }
+            } else {
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], rows->out_x, n);
+            }
+         } else if (z->s->img_n == 4) {
+            if (z->app14_color_transform == 0) { // CMYK
+               for (i=0; i < rows->out_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(coutput[0][i], m);
+                  out[1] = stbi__blinn_8x8(coutput[1][i], m);
+                  out[2] = stbi__blinn_8x8(coutput[2][i], m);
+                  out[3] = 255;
+                  out += n;
                }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-               for (i=0; i < z->s->img_x; ++i) {
+            } else if (z->app14_color_transform == 2) { // YCCK
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], rows->out_x, n);
+               for (i=0; i < rows->out_x; ++i) {
                   stbi_uc m = coutput[3][i];
-                  stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                  stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                  stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                  out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
+                  out[0] = stbi__blinn_8x8(255 - out[0], m);
+                  out[1] = stbi__blinn_8x8(255 - out[1], m);
+                  out[2] = stbi__blinn_8x8(255 - out[2], m);
                   out += n;
                }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+            } else { // YCbCr + alpha?  Ignore the fourth channel for now
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], rows->out_x, n);
+            }
+         } else
+            for (i=0; i < rows->out_x; ++i) {
+               out[0] = out[1] = out[2] = y[i];
+               out[3] = 255; // not used if n==3
+               out += n;
+            }
+      } else {
+         if (is_rgb) {
+            if (n == 1)
+               for (i=0; i < rows->out_x; ++i)
+                  *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+            else {
+               for (i=0; i < rows->out_x; ++i, out += 2) {
+                  out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
                   out[1] = 255;
-                  out += n;
                }
-            } else {
-               stbi_uc *y = coutput[0];
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-               else
-                  for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
             }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+            for (i=0; i < rows->out_x; ++i) {
+               stbi_uc m = coutput[3][i];
+               stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+               stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+               stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+               out[0] = stbi__compute_y(r, g, b);
+               out[1] = 255;
+               out += n;
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+            for (i=0; i < rows->out_x; ++i) {
+               out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+               out[1] = 255;
+               out += n;
+            }
+         } else {
+            stbi_uc *y = coutput[0];
+            if (n == 1)
+               for (i=0; i < rows->out_x; ++i) out[i] = y[i];
+            else
+               for (i=0; i < rows->out_x; ++i) { *out++ = y[i]; *out++ = 255; }
          }
       }
-      stbi__cleanup_jpeg(z);
-      *out_x = z->s->img_x;
-      *out_y = z->s->img_y;
-      if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
-      return output;
+      if (z->row_cb)
+         z->row_cb(z->row_user, (int) j, rows->output, (int) rows->out_x, (int) rows->out_y, n);
    }
+   rows->next_row = upto;
 }
 
-static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
+// convert every row the first mcu_rows decoded MCU rows are enough for; the
+// upsamplers read one plane row past the one they are on
+static int stbi__jpeg_rows_ready(stbi__jpeg *z, int mcu_rows)
+{
+   stbi__uint32 upto;
+   int k;
+   if (!z->rows && !stbi__jpeg_rows_begin(z)) return 0;
+   upto = z->rows->out_y;
+   for (k=0; k < z->rows->decode_n; ++k) {
+      stbi__uint32 avail = (stbi__uint32) (mcu_rows * z->img_comp[k].v * z->block_size);
+      if (avail < z->rows->comp_y[k]) {
+         stbi__uint32 lim = avail ? (avail - 1) * (stbi__uint32) z->rows->res_comp[k].vs : 0;
+         if (lim < upto) upto = lim;
+      }
+   }
+   if (upto > z->rows->next_row)
+      stbi__jpeg_rows_convert(z, upto);
+   return 1;
+}
+
+static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+{
+   stbi_uc *output;
+   z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+
+   // validate req_comp
+   if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+   z->req_comp = req_comp;
+
+   // load a jpeg image from whichever source, but leave in YCbCr format
+   if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
+
+   // resample and color-convert whatever hasn't been handed out yet
+   if (!z->rows && !stbi__jpeg_rows_begin(z)) { stbi__cleanup_jpeg(z); return NULL; }
+   stbi__jpeg_rows_convert(z, z->rows->out_y);
+
+   output = z->rows->output;
+   z->rows->output = NULL;
+   *out_x = z->rows->out_x;
+   *out_y = z->rows->out_y;
+   stbi__cleanup_jpeg(z);
+   if (comp) *comp = z->s->img_n >= 3 ? 3 : 1; // report original components, not output
+   return output;
+}
+
+static stbi_uc *stbi__jpeg_load_rows(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi_row_callback *row_cb, void *row_user)
 {
    unsigned char* result;
    stbi__jpeg* j = (stbi__jpeg*) stbi__malloc(sizeof(stbi__jpeg));
    if (!j) return stbi__errpuc("outofmem", "Out of memory");
    memset(j, 0, sizeof(stbi__jpeg));
-   STBI_NOTUSED(ri);
    j->s = s;
    stbi__setup_jpeg(j);
+   j->row_cb = row_cb;
+   j->row_user = row_user;
+   j->scale_log2 = stbi__jpeg_scale_on_load;
+   if (j->scale_log2) {
+      static void (* const reduced[4])(stbi_uc *, int, short *) = { NULL, stbi__idct_block_4x4, stbi__idct_block_2x2, stbi__idct_block_1x1 };
+      j->block_size = 8 >> j->scale_log2;
+      j->idct_block_kernel = reduced[j->scale_log2];
+   }
    result = load_jpeg_image(j, x,y,comp,req_comp);
    STBI_FREE(j);
    return result;
 }
 
+static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
+{
+   STBI_NOTUSED(ri);
+   return stbi__jpeg_load_rows(s, x, y, comp, req_comp, NULL, NULL);
+}
+
 static int stbi__jpeg_test(stbi__context *s)
 {
    int r;
@@ -7045,6 +7290,31 @@ static void *stbi__load_gif_main(stbi__context *s, int **delays, int *x, int *y,
    }
 }
 
+STBIDEF int stbi_load_gif_frames_from_memory(stbi_uc const *buffer, int len, stbi_gif_frame_callback *frame_cb, void *user)
+{
+   stbi__context s;
+   stbi__gif g;
+   stbi_uc *u;
+   int comp, frames = 0;
+
+   stbi__start_mem(&s,buffer,len);
+   if (!stbi__gif_test(&s))
+      return stbi__err("not GIF", "Image was not as a gif type.");
+   memset(&g, 0, sizeof(g));
+   for (;;) {
+      // g.background is the canvas as it was before the previous frame was drawn, which
+      // is exactly what "restore to previous" disposal goes back to
+      u = stbi__gif_load_next(&s, &g, &comp, 4, g.background);
+      if (u == 0 || u == (stbi_uc *) &s) break; // error, or end of animated gif marker
+      ++frames;
+      if (!frame_cb(user, frames - 1, u, g.w, g.h, g.delay)) break;
+   }
+   STBI_FREE(g.out);
+   STBI_FREE(g.history);
+   STBI_FREE(g.background);
+   return frames;
+}
+
 static void *stbi__gif_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
 {
    stbi_uc *u = 0;